@@ -0,0 +1,137 @@
+using namespace System;
+using namespace System::IO;
+using namespace System::IO::Compression;
+
+namespace PSCap {
+	//forward only reader of gzip compressed capture file
+	//frame table is stored at the end of capture file, so frames are walked one after another by their headers instead
+	ref class CaptureStream
+	{
+	protected:
+		Stream ^_stream;
+		//helper buffer for copying of decompressed data to native memory
+		array<Byte> ^_buffer;
+		//position in decompressed capture file
+		UInt64 _position;
+		//offsets and lengths in bytes of other data blocks declared in capture header; they may be stored between frames
+		array<UInt32> ^_blocks;
+		UInt32 _frameTableOffset;
+		//process info table; header stores number of its entries rather than length, so it cannot be skipped
+		UInt32 _processInfoOffset;
+		UInt32 _framesLeft;
+		//length of data netmon stores after captured data of each frame
+		DWORD _trailerLength;
+
+		//reads data from decompressed stream; when lpBuffer is nullptr, data are just skipped
+		void Read(LPVOID lpBuffer, DWORD length)
+		{
+			LPBYTE lpTarget = (LPBYTE) lpBuffer;
+			while (length > 0) {
+				int chunk = _stream->Read(_buffer, 0, (int) Math::Min((DWORD) _buffer->Length, length));
+				if (chunk == 0)
+					throw gcnew EndOfStreamException("CaptureStream");
+				if (lpTarget != nullptr) {
+					pin_ptr<Byte> pSource = &_buffer[0];
+					memcpy(lpTarget, pSource, chunk);
+					lpTarget += chunk;
+				}
+				length -= chunk;
+				_position += chunk;
+			}
+		}
+
+		//steps over data blocks stored at current position
+		void SkipBlocks()
+		{
+			bool skipped;
+			do {
+				skipped = false;
+				for (int i = 0; i < _blocks->Length; i += 2) {
+					if (_blocks[i + 1] > 0 && _blocks[i] == _position) {
+						Read(nullptr, _blocks[i + 1]);
+						skipped = true;
+					}
+				}
+			} while (skipped);
+
+			if (_processInfoOffset > 0 && _processInfoOffset == _position)
+				throw gcnew InvalidDataException("Process info stored between frames of compressed capture file is not supported");
+		}
+
+	public:
+		CaptureStream(String ^fileName, LPCAPFILEHEADER lpFileHeader)
+		{
+			FileStream ^fs = gcnew FileStream(fileName, FileMode::Open, FileAccess::Read, FileShare::Read, STREAM_BUFFER_SIZE, FileOptions::SequentialScan);
+			//GZipStream performs poorly with small reads, such as frame headers
+			_stream = gcnew BufferedStream(gcnew GZipStream(fs, CompressionMode::Decompress), STREAM_BUFFER_SIZE);
+			_buffer = gcnew array<Byte>(STREAM_BUFFER_SIZE);
+			try {
+				Read(lpFileHeader, sizeof(CAPFILEHEADER));
+				//1.x format uses different frame headers
+				if (lpFileHeader->BCDVerMajor != 2)
+					throw gcnew NotSupportedException("Only Netmon 2.x capture files can be read from compressed file");
+				switch (lpFileHeader->BCDVerMinor) {
+				case 0:
+					_trailerLength = 0;
+					break;
+				case 1:
+					_trailerLength = FRAMETRAILER_LENGTH_2_1;
+					break;
+				case 2:
+					_trailerLength = FRAMETRAILER_LENGTH_2_2;
+					break;
+				default:
+					_trailerLength = FRAMETRAILER_LENGTH_2_3;
+					break;
+				}
+				_frameTableOffset = lpFileHeader->FrameTableOffset;
+				_processInfoOffset = lpFileHeader->StatisticsOffset;
+				_framesLeft = lpFileHeader->FrameTableLength / sizeof(DWORD);
+				_blocks = gcnew array<UInt32> {
+					lpFileHeader->UserDataOffset, lpFileHeader->UserDataLength,
+					lpFileHeader->CommentDataOffset, lpFileHeader->CommentDataLength,
+					lpFileHeader->NetworkInfoOffset, lpFileHeader->NetworkInfoLength,
+					lpFileHeader->ConversationStatsOffset, lpFileHeader->ConversationStatsLength
+				};
+			}
+			catch (Exception^) {
+				_stream->Close();
+				throw;
+			}
+		}
+
+		~CaptureStream()
+		{
+			if (_stream != nullptr)
+				_stream->Close();
+		}
+
+		//reads metadata of next frame; returns false when all frames were read
+		bool ReadFrameHeader(LPFRAMEHEADER lpHdr)
+		{
+			if (_framesLeft == 0)
+				return false;
+			SkipBlocks();
+			if (_position >= _frameTableOffset)
+				return false;
+			Read(lpHdr, sizeof(FRAMEHEADER));
+			//we cannot seek to next frame from frame table, so any damage would make us lost in the rest of file
+			if (lpHdr->BytesAvailable > lpHdr->FrameLength)
+				throw gcnew InvalidDataException("Invalid frame header in compressed capture file");
+			_framesLeft--;
+			return true;
+		}
+
+		//reads captured data of current frame to lpData, or skips them when lpData is nullptr; returns MAC type of the frame
+		WORD ReadFrameData(LPFRAMEHEADER lpHdr, LPBYTE lpData)
+		{
+			BYTE trailer[FRAMETRAILER_LENGTH_2_3];
+
+			Read(lpData, lpHdr->BytesAvailable);
+			Read(trailer, _trailerLength);
+			if (_trailerLength == 0)
+				return 0;
+			return *(LPWORD) trailer;
+		}
+	};
+}
@@ -0,0 +1,162 @@
+using namespace System;
+using namespace System::IO;
+using namespace System::Security::Cryptography;
+using namespace System::Threading::Tasks;
+
+namespace PSCap {
+	//periodically persisted state of long running analysis of capture file, so as the analysis can be resumed when interrupted
+	//checkpoint is only valid for the same analysis of the same, unchanged, capture file
+	//each capture file and analysis has own checkpoint file in checkpoint directory, so as several captures can be processed in one pipeline
+	ref class CaptureCheckpoint
+	{
+	protected:
+		String ^_path;
+		String ^_analysis;
+		UInt32 _parameter;
+		Int64 _fileLength;
+		Int64 _fileTime;
+		//range of frame indexes a checkpoint can point to
+		UInt32 _firstFrame;
+		UInt32 _lastFrame;
+		//write of previous checkpoint; at most one write runs at a time
+		Task ^_pending;
+		int _lastSave;
+
+		//runs on thread pool so as frame processing is not stalled by disk I/O
+		void Write(Object ^state)
+		{
+			//checkpoint is replaced only when new one is completely written
+			String ^tempPath = _path + ".tmp";
+			File::WriteAllBytes(tempPath, (array<Byte>^) state);
+			if (File::Exists(_path))
+				File::Replace(tempPath, _path, nullptr);
+			else
+				File::Move(tempPath, _path);
+		}
+
+	public:
+		CaptureCheckpoint(String ^directory, CaptureFileInfo ^ci, String ^analysis, UInt32 parameter)
+		{
+			FileInfo ^fi = gcnew FileInfo(ci->Name);
+
+			//file name is readable, hash of full path makes it unique for captures with the same name in different folders
+			String ^key = String::Format("{0}|{1}|{2}", fi->FullName->ToUpperInvariant(), analysis, parameter);
+			SHA1 ^sha = SHA1::Create();
+			array<Byte> ^hash = sha->ComputeHash(System::Text::Encoding::UTF8->GetBytes(key));
+			delete sha;
+			String ^name = String::Format("{0}.{1}.{2}.checkpoint", fi->Name, analysis, BitConverter::ToString(hash, 0, 8)->Replace("-", ""));
+			Directory::CreateDirectory(directory);
+			_path = Path::Combine(Path::GetFullPath(directory), name);
+
+			_analysis = analysis;
+			_parameter = parameter;
+			_fileLength = fi->Length;
+			_fileTime = fi->LastWriteTimeUtc.Ticks;
+			_firstFrame = ci->NetmonFrames;
+			_lastFrame = ci->NetmonFrames + ci->Frames;
+			_lastSave = Environment::TickCount;
+		}
+
+		~CaptureCheckpoint()
+		{
+			//failure of the last write is reported by Flush() or Complete() called by cmdlet
+			Flush();
+		}
+
+		//waits for checkpoint being written; returns failure of the write, if any
+		Exception^ Flush()
+		{
+			Task ^pending = _pending;
+			if (pending == nullptr)
+				return nullptr;
+			_pending = nullptr;
+			try {
+				pending->Wait();
+			}
+			catch (AggregateException ^ex) {
+				return ex->InnerException;
+			}
+			return nullptr;
+		}
+
+		//returns reader positioned at saved aggregator state and index of first frame not processed yet
+		//returns nullptr when there is no valid checkpoint of this analysis
+		//caller shall start from the beginning when saved aggregator state cannot be read either
+		BinaryReader^ Load(UInt32 %frameIndex)
+		{
+			if (!File::Exists(_path))
+				return nullptr;
+			BinaryReader ^br;
+			try {
+				br = gcnew BinaryReader(gcnew MemoryStream(File::ReadAllBytes(_path)));
+				if (br->ReadUInt32() != CHECKPOINT_SIGNATURE || br->ReadByte() != CHECKPOINT_VERSION)
+					return nullptr;
+				if (!String::Equals(br->ReadString(), _analysis) || br->ReadUInt32() != _parameter)
+					return nullptr;
+				if (br->ReadInt64() != _fileLength || br->ReadInt64() != _fileTime)
+					return nullptr;
+				UInt32 index = br->ReadUInt32();
+				if (index < _firstFrame || index > _lastFrame)
+					return nullptr;
+				frameIndex = index;
+			}
+			catch (IOException^) {
+				//incomplete checkpoint or checkpoint file not accessible
+				return nullptr;
+			}
+			catch (UnauthorizedAccessException^) {
+				return nullptr;
+			}
+			catch (FormatException^) {
+				//damaged string in checkpoint
+				return nullptr;
+			}
+			return br;
+		}
+
+		//checkpoints are written after some time passed since the previous one, and only when previous write finished
+		bool IsDue()
+		{
+			if (_pending != nullptr && !_pending->IsCompleted)
+				return false;
+			return Environment::TickCount - _lastSave >= CHECKPOINT_PERIOD_MS;
+		}
+
+		//starts new checkpoint; aggregator state is then written to returned writer and passed to Save()
+		BinaryWriter^ Begin(UInt32 frameIndex)
+		{
+			BinaryWriter ^bw = gcnew BinaryWriter(gcnew MemoryStream());
+			bw->Write((UInt32) CHECKPOINT_SIGNATURE);
+			bw->Write((Byte) CHECKPOINT_VERSION);
+			bw->Write(_analysis);
+			bw->Write(_parameter);
+			bw->Write(_fileLength);
+			bw->Write(_fileTime);
+			bw->Write(frameIndex);
+			return bw;
+		}
+
+		//writes checkpoint in background; returns failure of previous checkpoint write, if any
+		Exception^ Save(BinaryWriter ^bw)
+		{
+			Exception ^previousError = nullptr;
+			if (_pending != nullptr && _pending->IsFaulted)
+				previousError = _pending->Exception->InnerException;
+
+			bw->Flush();
+			array<Byte> ^state = ((MemoryStream^) bw->BaseStream)->ToArray();
+			_pending = Task::Factory->StartNew(gcnew Action<Object^>(this, &CaptureCheckpoint::Write), state);
+			_lastSave = Environment::TickCount;
+			return previousError;
+		}
+
+		//analysis finished, so checkpoint is not needed anymore; returns failure of the last checkpoint write, if any
+		Exception^ Complete()
+		{
+			Exception ^error = Flush();
+			if (File::Exists(_path))
+				File::Delete(_path);
+			return error;
+		}
+	};
+}
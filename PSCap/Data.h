@@ -12,9 +12,18 @@ namespace PSCap {
 	public:
 		String ^Name;
 		bool IsOldFormat;
+		//gzip compressed capture file; frames can only be read sequentially
+		bool IsCompressed;
 		DateTime ^Timestamp;
 		UInt32 Frames;
 		UInt32 FrameTableOffset;
+		//number of entries in frame table, including netmon special frames and 2.x trailer frame
+		UInt32 FrameTableEntries;
+		//number of netmon 3.x special frames stored at the beginning of file
+		UInt32 NetmonFrames;
+		DateTime ^FirstFrameTimestamp;
+		DateTime ^LastFrameTimestamp;
+		TimeSpan ^Duration;
 
 		CaptureFileInfo(String^ Name)
 		{
@@ -0,0 +1,278 @@
+using namespace System;
+using namespace System::IO;
+using namespace System::Collections::Concurrent;
+using namespace System::Threading;
+
+namespace PSCap {
+	//sequential access to frames of capture file, regardless of how the file is stored
+	ref class FrameReader abstract
+	{
+	public:
+		~FrameReader() {}
+
+		//reads next frame; lpData receives captured frame data when reader was opened with data, nullptr otherwise
+		//frame data are valid until next call; returns false when there are no more frames
+		virtual bool ReadFrame(LPFRAMEHEADER lpHdr, LPBYTE *lpData) = 0;
+
+		virtual void Skip(UInt32 frames)
+		{
+			FRAMEHEADER hdr;
+			LPBYTE lpData;
+			for (UInt32 i = 0; i < frames; i++) {
+				if (!ReadFrame(&hdr, &lpData))
+					throw gcnew EndOfStreamException("Skip");
+			}
+		}
+
+		static FrameReader^ Open(CaptureFileInfo ^ci, bool withData);
+	};
+
+	//reads frames of uncompressed capture file in order given by frame table
+	ref class TableFrameReader : public FrameReader
+	{
+	protected:
+		HANDLE _inStream;
+		//to speed up processing, we read complete frame table from capture file to memory
+		LPDWORD _frameTable;
+		UInt32 _entries;
+		UInt32 _nextEntry;
+		bool _withData;
+		//buffer for raw frame data, reused for all frames
+		LPBYTE _frameData;
+		DWORD _frameDataLength;
+
+	public:
+		TableFrameReader(CaptureFileInfo ^ci, bool withData)
+		{
+			_inStream = INVALID_HANDLE_VALUE;
+			_withData = withData;
+			_entries = ci->FrameTableEntries;
+
+			//allocate memory for frame table
+			UInt32 frameTableLength = _entries*sizeof(DWORD);
+			_frameTable = (LPDWORD) malloc(frameTableLength);
+			if (_frameTable == nullptr)
+				throw gcnew OutOfMemoryException("AllocFrameTable");
+
+			//open the capture file
+			pin_ptr<const wchar_t> inFile = PtrToStringChars(ci->Name);
+			_inStream = ::CreateFile(inFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (_inStream == INVALID_HANDLE_VALUE)
+				throw gcnew System::ComponentModel::Win32Exception(::GetLastError(), "CreateFile");
+
+			//read frame table into memory
+			PSUtils::ReadAt(_inStream, ci->FrameTableOffset, _frameTable, frameTableLength);
+		}
+
+		~TableFrameReader()
+		{
+			this->!TableFrameReader();
+		}
+
+		!TableFrameReader()
+		{
+			if (_inStream != INVALID_HANDLE_VALUE) {
+				CloseHandle(_inStream);
+				_inStream = INVALID_HANDLE_VALUE;
+			}
+			if (_frameTable != nullptr) {
+				free(_frameTable);
+				_frameTable = nullptr;
+			}
+			if (_frameData != nullptr) {
+				free(_frameData);
+				_frameData = nullptr;
+			}
+		}
+
+		virtual bool ReadFrame(LPFRAMEHEADER lpHdr, LPBYTE *lpData) override
+		{
+			if (_nextEntry >= _entries)
+				return false;
+
+			//get current frame in capture file
+			DWORD frameOffset = _frameTable[_nextEntry++];
+			PSUtils::ReadAt(_inStream, frameOffset, lpHdr, sizeof(FRAMEHEADER));
+			*lpData = nullptr;
+			if (!_withData)
+				return true;
+
+			if (lpHdr->BytesAvailable > _frameDataLength) {
+				LPBYTE lpBuffer = (LPBYTE) realloc(_frameData, lpHdr->BytesAvailable);
+				if (lpBuffer == nullptr)
+					throw gcnew OutOfMemoryException("AllocFrameData");
+				_frameData = lpBuffer;
+				_frameDataLength = lpHdr->BytesAvailable;
+			}
+			PSUtils::ReadAt(_inStream, (UInt64) frameOffset + sizeof(FRAMEHEADER), _frameData, lpHdr->BytesAvailable);
+			*lpData = _frameData;
+			return true;
+		}
+
+		//frame table tells us where frames are, so no need to read skipped frames
+		virtual void Skip(UInt32 frames) override
+		{
+			if (frames > _entries - _nextEntry)
+				throw gcnew EndOfStreamException("Skip");
+			_nextEntry += frames;
+		}
+	};
+
+	//reads frames of gzip compressed capture file
+	//decompression runs on background thread and hands frames over in batches, so as it overlaps with frame processing
+	ref class GZipFrameReader : public FrameReader
+	{
+	protected:
+		//frames stored one after another as frame header followed by captured data (when reader was opened with data)
+		ref class FrameBatch
+		{
+		public:
+			LPBYTE Data;
+			DWORD Capacity;
+			DWORD Length;
+
+			FrameBatch(DWORD capacity)
+			{
+				Data = (LPBYTE) malloc(capacity);
+				if (Data == nullptr)
+					throw gcnew OutOfMemoryException("AllocFrameBatch");
+				Capacity = capacity;
+			}
+
+			~FrameBatch()
+			{
+				this->!FrameBatch();
+			}
+
+			!FrameBatch()
+			{
+				if (Data != nullptr) {
+					free(Data);
+					Data = nullptr;
+				}
+			}
+		};
+
+		CaptureStream ^_stream;
+		bool _withData;
+		Thread ^_producer;
+		CancellationTokenSource ^_cancel;
+		//batches ready for processing
+		BlockingCollection<FrameBatch^> ^_full;
+		//processed batches the producer can reuse
+		ConcurrentBag<FrameBatch^> ^_free;
+		//failure of producer, reported when consumer runs out of frames
+		Exception ^_error;
+		FrameBatch ^_current;
+		DWORD _currentOffset;
+
+		FrameBatch^ GetBatch(DWORD minCapacity)
+		{
+			FrameBatch ^batch;
+			if (_free->TryTake(batch)) {
+				if (batch->Capacity >= minCapacity) {
+					batch->Length = 0;
+					return batch;
+				}
+				//too small for this frame
+				delete batch;
+			}
+			return gcnew FrameBatch(Math::Max((DWORD) FRAMEBATCH_SIZE, minCapacity));
+		}
+
+		void Produce()
+		{
+			FRAMEHEADER hdr;
+			FrameBatch ^batch = nullptr;
+			try {
+				while (_stream->ReadFrameHeader(&hdr)) {
+					DWORD recordLength = sizeof(FRAMEHEADER) + (_withData ? hdr.BytesAvailable : 0);
+					if (batch != nullptr && batch->Length + recordLength > batch->Capacity) {
+						_full->Add(batch, _cancel->Token);
+						batch = nullptr;
+					}
+					if (batch == nullptr)
+						batch = GetBatch(recordLength);
+
+					LPBYTE lpRecord = batch->Data + batch->Length;
+					memcpy(lpRecord, &hdr, sizeof(FRAMEHEADER));
+					_stream->ReadFrameData(&hdr, _withData ? lpRecord + sizeof(FRAMEHEADER) : nullptr);
+					batch->Length += recordLength;
+				}
+				if (batch != nullptr)
+					_full->Add(batch, _cancel->Token);
+			}
+			catch (OperationCanceledException^) {
+				//reader disposed before all frames were read
+			}
+			catch (Exception ^ex) {
+				_error = ex;
+			}
+			finally {
+				_full->CompleteAdding();
+			}
+		}
+
+	public:
+		GZipFrameReader(CaptureFileInfo ^ci, bool withData)
+		{
+			CAPFILEHEADER fileHeader;
+
+			_withData = withData;
+			_stream = gcnew CaptureStream(ci->Name, &fileHeader);
+			_cancel = gcnew CancellationTokenSource();
+			_full = gcnew BlockingCollection<FrameBatch^>(FRAMEBATCH_QUEUE_LENGTH);
+			_free = gcnew ConcurrentBag<FrameBatch^>();
+
+			_producer = gcnew Thread(gcnew ThreadStart(this, &GZipFrameReader::Produce));
+			_producer->IsBackground = true;
+			_producer->Start();
+		}
+
+		~GZipFrameReader()
+		{
+			FrameBatch ^batch;
+
+			_cancel->Cancel();
+			_producer->Join();
+			delete _stream;
+
+			if (_current != nullptr)
+				delete _current;
+			while (_full->TryTake(batch))
+				delete batch;
+			while (_free->TryTake(batch))
+				delete batch;
+		}
+
+		virtual bool ReadFrame(LPFRAMEHEADER lpHdr, LPBYTE *lpData) override
+		{
+			if (_current == nullptr || _currentOffset >= _current->Length) {
+				if (_current != nullptr) {
+					_free->Add(_current);
+					_current = nullptr;
+				}
+				//returns false when producer is done and all batches were processed
+				if (!_full->TryTake(_current, Timeout::Infinite)) {
+					if (_error != nullptr)
+						throw gcnew IOException("Failed to read compressed capture file", _error);
+					return false;
+				}
+				_currentOffset = 0;
+			}
+
+			LPBYTE lpRecord = _current->Data + _currentOffset;
+			memcpy(lpHdr, lpRecord, sizeof(FRAMEHEADER));
+			*lpData = _withData ? lpRecord + sizeof(FRAMEHEADER) : nullptr;
+			_currentOffset += sizeof(FRAMEHEADER) + (_withData ? lpHdr->BytesAvailable : 0);
+			return true;
+		}
+	};
+
+	FrameReader^ FrameReader::Open(CaptureFileInfo ^ci, bool withData)
+	{
+		if (ci->IsCompressed)
+			return gcnew GZipFrameReader(ci, withData);
+		return gcnew TableFrameReader(ci, withData);
+	}
+}
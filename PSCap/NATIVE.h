@@ -7,6 +7,24 @@
 //1 hour = 3600000000 microseconds
 //this means that there must be at least 1 frame an hour in capture so as it was correctly processed
 #define MAX_TIMESTAMP_DIFFERENCE 3600000000
+//frames with MAC type equal or above this value are netmon special frames (process info, comments, etc.)
+#define NETMON_SPECIAL_FRAME_MAC 0xFFFB
+//netmon 2.1+ stores MAC type after frame data; 2.2 adds process info index, 2.3 also UTC timestamp and timezone index
+#define FRAMETRAILER_LENGTH_2_1 2
+#define FRAMETRAILER_LENGTH_2_2 6
+#define FRAMETRAILER_LENGTH_2_3 15
+//first two bytes of gzip compressed file
+#define GZIP_SIGNATURE 0x8B1F
+//buffer size for reading of compressed capture file
+#define STREAM_BUFFER_SIZE 0x10000
+//decompressed frames are handed over to processing in batches of this size; at most FRAMEBATCH_QUEUE_LENGTH batches wait for processing
+#define FRAMEBATCH_SIZE 0x100000
+#define FRAMEBATCH_QUEUE_LENGTH 4
+//minimal time between checkpoints of long running analysis
+#define CHECKPOINT_PERIOD_MS 30000
+//'PSCK' - identifies checkpoint file
+#define CHECKPOINT_SIGNATURE 0x4B435350
+#define CHECKPOINT_VERSION 1
 namespace PSCap
 {
 	typedef struct _FRAMEHEADER
@@ -4,6 +4,9 @@
 #include "NATIVE.h"
 #include "resource.h"
 #include "Data.h"
+#include "CaptureStream.h"
 #include "PSUtils.h"
+#include "FrameReader.h"
+#include "Checkpoint.h"
 #include "PSCap.h"
 
@@ -8,28 +8,141 @@ using namespace System::IO;
 using namespace System::Resources;
 using namespace System::Reflection;
 using namespace System::Collections::Generic;
+using namespace System::Collections::Concurrent;
+using namespace System::Threading;
 
 
 namespace PSCap {
 	[CmdletAttribute("Get", "CaptureFileInfo")]
 	public ref class GetCaptureInfo:public Cmdlet
 	{
+	protected:
+		//bulk mode: files waiting for workers and results waiting to be written to pipeline
+		BlockingCollection<String^> ^_pending;
+		BlockingCollection<Object^> ^_results;
+		CancellationTokenSource ^_cancel;
+		array<Thread^> ^_workers;
+		int _activeWorkers;
+
+		void Worker()
+		{
+			try {
+				for each (String ^fileName in _pending->GetConsumingEnumerable(_cancel->Token))
+				{
+					//single broken file shall not stop the whole inventory
+					try {
+						if (!File::Exists(fileName))
+							throw gcnew FileNotFoundException(nullptr, fileName);
+						_results->Add(PSUtils::GetCaptureInfo(fileName));
+					}
+					catch (Exception ^ex) {
+						_results->Add(gcnew ErrorRecord(ex, "GetCaptureFileInfo", ErrorCategory::ReadError, fileName));
+					}
+				}
+			}
+			catch (OperationCanceledException^) {
+				//pipeline stopped
+			}
+			finally {
+				//last worker tells the pipeline thread there is nothing more to wait for
+				if (Interlocked::Decrement(_activeWorkers) == 0)
+					_results->CompleteAdding();
+			}
+		}
+
+		//output must be written from pipeline thread, so workers only queue results
+		void WriteResult(Object ^result)
+		{
+			ErrorRecord ^er = dynamic_cast<ErrorRecord^>(result);
+			if (er != nullptr)
+				WriteError(er);
+			else
+				WriteObject(result);
+		}
+
 	public:
 		[Parameter(Mandatory=true, Position=0, ValueFromPipeline=true)]
 		property String ^CaptureFile;
+		//number of files processed concurrently; with default 1 files are processed one by one as they come
+		[Parameter()]
+		[ValidateRange(1, 64)]
+		property UInt32 ThrottleLimit;
+
+		GetCaptureInfo()
+		{
+			ThrottleLimit = 1;
+		}
 
 		virtual void BeginProcessing() override
 		{
 			PSUtils::SyncWorkingDirectory();
+
+			if (ThrottleLimit > 1) {
+				//bounded queue so as we do not read whole pipeline input to memory ahead of workers
+				_pending = gcnew BlockingCollection<String^>(ThrottleLimit * 4);
+				_results = gcnew BlockingCollection<Object^>();
+				_cancel = gcnew CancellationTokenSource();
+				_activeWorkers = (int) ThrottleLimit;
+				_workers = gcnew array<Thread^>(ThrottleLimit);
+				for (UInt32 i = 0; i < ThrottleLimit; i++) {
+					_workers[i] = gcnew Thread(gcnew ThreadStart(this, &GetCaptureInfo::Worker));
+					_workers[i]->IsBackground = true;
+					_workers[i]->Start();
+				}
+			}
 		}
 
 		virtual void ProcessRecord() override
 		{
+			if (_pending != nullptr) {
+				_pending->Add(CaptureFile, _cancel->Token);
+				//flush whatever workers have finished so far
+				Object ^result;
+				while (_results->TryTake(result))
+					WriteResult(result);
+				return;
+			}
+
 			if(!File::Exists(CaptureFile))
 				throw gcnew FileNotFoundException();
 
 			WriteObject(PSUtils::GetCaptureInfo(CaptureFile));
 		}
+
+		virtual void EndProcessing() override
+		{
+			if (_pending == nullptr)
+				return;
+
+			_pending->CompleteAdding();
+			for each (Object ^result in _results->GetConsumingEnumerable())
+				WriteResult(result);
+		}
+
+		virtual void StopProcessing() override
+		{
+			if (_cancel != nullptr)
+				_cancel->Cancel();
+		}
+
+		//PowerShell disposes the cmdlet also when downstream command ends the pipeline early,
+		//in which case neither EndProcessing nor StopProcessing is called
+		~GetCaptureInfo()
+		{
+			if (_pending == nullptr)
+				return;
+
+			_cancel->Cancel();
+			_pending->CompleteAdding();
+			//workers still use the collections, so they must finish first
+			for each (Thread ^worker in _workers)
+				worker->Join();
+
+			delete _pending;
+			delete _results;
+			delete _cancel;
+			_pending = nullptr;
+		}
 	};
 
 	[CmdletAttribute("Get", "CaptureBandwidthStats")]
@@ -38,6 +151,15 @@ namespace PSCap {
 	protected:
 		String ^_template_Activity;
 		String ^_template_StatusDescription;
+		String ^_template_CheckpointResumed;
+		String ^_template_CheckpointFailed;
+
+		//checkpoints are written in background, so their failure is only known later
+		void WarnCheckpointFailure(Exception ^ex)
+		{
+			if (ex != nullptr)
+				WriteWarning(String::Format(_template_CheckpointFailed, ex->Message));
+		}
 	public:
 		[Parameter(Mandatory=true, Position=0, ValueFromPipeline=true)]
 		property String ^CaptureFile;
@@ -45,6 +167,9 @@ namespace PSCap {
 		property UInt32 Interval;
 		[Parameter()]
 		property SwitchParameter ShowProgress;
+		//directory where state of analysis of each capture file is periodically saved; when analysis is interrupted, it resumes from there next time
+		[Parameter()]
+		property String ^CheckpointPath;
 
 
 		virtual void BeginProcessing() override
@@ -56,6 +181,8 @@ namespace PSCap {
 			ResourceManager ^rm=gcnew ResourceManager("PSCap.Messages",Assembly::GetExecutingAssembly());
 			_template_Activity=rm->GetString("IDS_TEMPLATE_ACTIVITY");
 			_template_StatusDescription=rm->GetString("IDS_TEMPLATE_STATUS_DESCRIPTION");
+			_template_CheckpointResumed=rm->GetString("IDS_TEMPLATE_CHECKPOINT_RESUMED");
+			_template_CheckpointFailed=rm->GetString("IDS_TEMPLATE_CHECKPOINT_FAILED");
 		}
 
 		virtual void ProcessRecord() override
@@ -66,13 +193,13 @@ namespace PSCap {
 				throw gcnew ArgumentException("Interval");
 			CaptureFileInfo^ ci=PSUtils::GetCaptureInfo(CaptureFile);
 			
-			//handle for reading the capture file
-			HANDLE inStream=INVALID_HANDLE_VALUE;
-			//pointer to frametable in memory. To speed up processing, we read complete frame table from capture file to memory
-			LPDWORD frameTable=nullptr;
+			//frames of the capture file, read via frame table or streamed from compressed file
+			FrameReader ^reader=nullptr;
+			//state of analysis saved periodically when requested
+			CaptureCheckpoint ^checkpoint=nullptr;
 			ULONG frameSize;
 			//timestamp of each frame. Retrieved from frame metadata
-			UInt64 frameTimestamp;
+			UInt64 frameTimestamp=0;
 			//progress tracing;
 			UInt32 progressStep; 
 			UInt32 progressMark;
@@ -90,73 +217,27 @@ namespace PSCap {
 				UInt64 intervalLength=(UInt64)(Interval) * (UInt64)(MICROSECONDS_IN_SECOND * 10);
 				
 				//number of frames in capture file we want to process
-				UInt32 frameCount=ci->Frames;
+				//Netmon 2.x stores capture file info as a last frame; it is not counted in ci->Frames so we do not process it
+				UInt32 frameCount=ci->NetmonFrames + ci->Frames;
 				
 				//number of frames processed after we update progress
 				progressStep=ci->Frames / 100;
 				progressMark=progressStep;
 
-				//Netmon 2.x stores capture file info as a last frame; we do not want process it
-				if(ci->IsOldFormat)
-					frameCount--;
-
-				//allocate memory for frame table
-				UInt32 frameTableLength=ci->Frames*sizeof(DWORD);
-				frameTable=(LPDWORD)malloc(frameTableLength);
-				if(frameTable==nullptr)
-					throw gcnew OutOfMemoryException("AllocFrameTable");
-
-				//helper for ::ReadFile() API
-				DWORD dwBytesRead;
-
-				//open the capture file
-				pin_ptr<const wchar_t> inFile=PtrToStringChars(ci->Name);
-				inStream=::CreateFile(inFile,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
-				if(inStream==INVALID_HANDLE_VALUE)
-					throw gcnew System::ComponentModel::Win32Exception(::GetLastError(),"CreateFile");
-
-				//read frame table into memory
-				LPDWORD nextTableEntry=frameTable;
-				::SetFilePointer(inStream,ci->FrameTableOffset,NULL,FILE_BEGIN);
-				::ReadFile(inStream,frameTable,frameTableLength,&dwBytesRead,NULL);
-				if(dwBytesRead!=frameTableLength)
-					throw gcnew Exception("Was not able to read complete frame table");
+				//open the capture file; we only need frame metadata
+				reader=FrameReader::Open(ci,false);
 
 				//end of current interval
 				UInt64 nLimit=captureTimestamp + intervalLength;
 
-				//pointer to buffer for frame metadata
-				LPFRAMEHEADER lpHdr=nullptr;
-				//pointer for raw frame data
-				//TODO: filtering based on IP address, port, protocol
-				LPBYTE rawFrameData=nullptr;
-
-				//try eliminate netmon 3.x special frames - stored as first frames in file
-				UInt64 timestampScalingFactor=0;
-				bool isNetmonFrame=true;
-				ULONG numNetmonFrames=0;
-				ULONG frameOffset=0L;
-				do {
-					::SetFilePointer(inStream,*nextTableEntry,NULL,FILE_BEGIN);
-					lpHdr=(LPFRAMEHEADER)malloc(sizeof(FRAMEHEADER));
-					::ReadFile(inStream,lpHdr,sizeof(FRAMEHEADER),&dwBytesRead,NULL);
-
-					//skip frame data to get to MAC type
-					::SetFilePointer(inStream, lpHdr->BytesAvailable, NULL, FILE_CURRENT);
-					//get mac type
-					WORD frameMac;
-					::ReadFile(inStream,&frameMac,sizeof(WORD),&dwBytesRead,NULL);
-					if(frameMac<0xFFFB) {
-						//not a netmon special frame
-						isNetmonFrame=false;
-					}
-					else {
-						nextTableEntry++;
-						numNetmonFrames++;
-					}
-					free(lpHdr);
+				//buffer for frame metadata
+				FRAMEHEADER hdr;
+				LPFRAMEHEADER lpHdr=&hdr;
+				//frame data are not read, so reader always returns nullptr here
+				LPBYTE lpData;
 
-				} while (isNetmonFrame==true);
+				//skip netmon 3.x special frames - stored as first frames in file
+				UInt32 firstFrame=ci->NetmonFrames;
 
 				//process frames
 				bool _isAtStart=true;
@@ -164,7 +245,61 @@ namespace PSCap {
 				unsigned __int64 prevTimeStamp=0;
 				//this is outpput data
 				CaptureIntervalStats^ cis=gcnew CaptureIntervalStats();
-				for(UInt32 i=numNetmonFrames;i<frameCount;i++) {
+
+				//continue from interval in progress when previous run was interrupted
+				//intervals completed before the checkpoint are not written again
+				if(CheckpointPath != nullptr) {
+					checkpoint=gcnew CaptureCheckpoint(CheckpointPath,ci,"BandwidthStats",Interval);
+					BinaryReader ^br=checkpoint->Load(firstFrame);
+					if(br != nullptr) {
+						try {
+							//state is only used when it was read completely
+							DWORD savedInterval=br->ReadUInt32();
+							UInt64 savedLimit=br->ReadUInt64();
+							bool savedAtStart=br->ReadBoolean();
+							unsigned __int64 savedPrevTimeStamp=br->ReadUInt64();
+							UInt64 savedFrameTimestamp=br->ReadUInt64();
+							UInt32 savedBytes=br->ReadUInt32();
+							UInt32 savedFrames=br->ReadUInt32();
+
+							dwCurrentInterval=savedInterval;
+							nLimit=savedLimit;
+							_isAtStart=savedAtStart;
+							prevTimeStamp=savedPrevTimeStamp;
+							frameTimestamp=savedFrameTimestamp;
+							cis->Bytes=savedBytes;
+							cis->Frames=savedFrames;
+							if(progressStep > 0)
+								progressMark=(firstFrame / progressStep + 1) * progressStep;
+							WriteVerbose(String::Format(_template_CheckpointResumed,CaptureFile,firstFrame));
+						}
+						catch(IOException^) {
+							//damaged checkpoint - start from the beginning
+							firstFrame=ci->NetmonFrames;
+						}
+						catch(FormatException^) {
+							firstFrame=ci->NetmonFrames;
+						}
+						catch(UnauthorizedAccessException^) {
+							firstFrame=ci->NetmonFrames;
+						}
+					}
+				}
+				reader->Skip(firstFrame);
+
+				for(UInt32 i=firstFrame;i<frameCount;i++) {
+					//state is saved before frame i is processed, so as resumed run starts with it
+					if(checkpoint != nullptr && checkpoint->IsDue()) {
+						BinaryWriter ^bw=checkpoint->Begin(i);
+						bw->Write((UInt32)dwCurrentInterval);
+						bw->Write(nLimit);
+						bw->Write(_isAtStart);
+						bw->Write(prevTimeStamp);
+						bw->Write(frameTimestamp);
+						bw->Write(cis->Bytes);
+						bw->Write(cis->Frames);
+						WarnCheckpointFailure(checkpoint->Save(bw));
+					}
 					if(ShowProgress && i > progressMark) {
 						ProgressRecord ^pr=gcnew ProgressRecord(
 							0,
@@ -182,17 +317,9 @@ namespace PSCap {
 						WriteProgress(pr);
 						progressMark+=progressStep;
 					}
-					//get current frame in capture file
-					::SetFilePointer(inStream,*nextTableEntry,NULL,FILE_BEGIN);
-					nextTableEntry++;
-					//read frame metadata
-					lpHdr=(LPFRAMEHEADER)malloc(sizeof(FRAMEHEADER));
-					::ReadFile(inStream,lpHdr,sizeof(FRAMEHEADER),&dwBytesRead,NULL);
-
-					//TODO: filtering based on IP address, port, protocol
-					//we will need to process raw frame data then - this is how to read it
-					//rawFrameData=(LPBYTE)malloc(lpHdr->BytesAvailable);
-					//::ReadFile(inStream,rawFrameData,lpHdr->BytesAvailable,&dwBytesRead,NULL);
+					//read frame metadata of current frame in capture file
+					if(!reader->ReadFrame(lpHdr,&lpData))
+						throw gcnew EndOfStreamException("Capture file ended before all frames were read");
 
 					//get info about frame
 					frameSize=lpHdr->FrameLength;
@@ -226,11 +353,6 @@ namespace PSCap {
 					cis->Bytes+=frameSize;
 					//also sum frames
 					cis->Frames++;
-
-					//prepare for the next frame
-					free(lpHdr);
-					//TODO: filtering based on IP address, port, protocol
-					//free(rawFrameData);
 				}	//for
 				//write last data
 				cis->Timestamp=DateTime::FromFileTimeUtc(captureTimestamp+((UInt64)dwCurrentInterval*intervalLength));
@@ -254,12 +376,26 @@ namespace PSCap {
 					pr->RecordType=ProgressRecordType::Completed;
 					WriteProgress(pr);
 				}
+				if(checkpoint != nullptr)
+					WarnCheckpointFailure(checkpoint->Complete());
+			}
+			catch(Exception^) {
+				//analysis interrupted - resume relies on the last checkpoint, so tell when it was not written
+				if(checkpoint != nullptr) {
+					try {
+						WarnCheckpointFailure(checkpoint->Flush());
+					}
+					catch(PipelineStoppedException^) {
+						//warning cannot be written to stopped pipeline
+					}
+				}
+				throw;
 			}
 			finally {
-				if(inStream != INVALID_HANDLE_VALUE)
-					CloseHandle(inStream);
-				if(frameTable != nullptr)
-					free(frameTable);
+				if(reader != nullptr)
+					delete reader;
+				if(checkpoint != nullptr)
+					delete checkpoint;
 			}
 		}
 	};
@@ -270,12 +406,24 @@ namespace PSCap {
 	protected:
 		String ^_template_Activity;
 		String ^_template_StatusDescription;
+		String ^_template_CheckpointResumed;
+		String ^_template_CheckpointFailed;
+
+		//checkpoints are written in background, so their failure is only known later
+		void WarnCheckpointFailure(Exception ^ex)
+		{
+			if (ex != nullptr)
+				WriteWarning(String::Format(_template_CheckpointFailed, ex->Message));
+		}
 		Dictionary<UInt32, Dictionary<UInt32, CaptureP2PStats^>^> ^data = gcnew Dictionary<UInt32, Dictionary<UInt32, CaptureP2PStats^>^>();
 	public:
 		[Parameter(Mandatory = true, Position = 0, ValueFromPipeline = true)]
 		property String ^CaptureFile;
 		[Parameter()]
 		property SwitchParameter ShowProgress;
+		//directory where state of analysis of each capture file is periodically saved; when analysis is interrupted, it resumes from there next time
+		[Parameter()]
+		property String ^CheckpointPath;
 
 
 		virtual void BeginProcessing() override
@@ -287,6 +435,8 @@ namespace PSCap {
 			ResourceManager ^rm = gcnew ResourceManager("PSCap.Messages", Assembly::GetExecutingAssembly());
 			_template_Activity = rm->GetString("IDS_TEMPLATE_ACTIVITY");
 			_template_StatusDescription = rm->GetString("IDS_TEMPLATE_STATUS_DESCRIPTION");
+			_template_CheckpointResumed = rm->GetString("IDS_TEMPLATE_CHECKPOINT_RESUMED");
+			_template_CheckpointFailed = rm->GetString("IDS_TEMPLATE_CHECKPOINT_FAILED");
 		}
 
 		virtual void ProcessRecord() override
@@ -295,81 +445,102 @@ namespace PSCap {
 				throw gcnew FileNotFoundException();
 			CaptureFileInfo^ ci = PSUtils::GetCaptureInfo(CaptureFile);
 
-			//handle for reading the capture file
-			HANDLE inStream = INVALID_HANDLE_VALUE;
-			//pointer to frametable in memory. To speed up processing, we read complete frame table from capture file to memory
-			LPDWORD frameTable = nullptr;
+			//frames of the capture file, read via frame table or streamed from compressed file
+			FrameReader ^reader = nullptr;
+			//state of analysis saved periodically when requested
+			CaptureCheckpoint ^checkpoint = nullptr;
 			//progress tracing;
 			UInt32 progressStep;
 			UInt32 progressMark;
 			try {
 
 				//number of frames in capture file we want to process
-				UInt32 frameCount = ci->Frames;
+				//Netmon 2.x stores capture file info as a last frame; it is not counted in ci->Frames so we do not process it
+				UInt32 frameCount = ci->NetmonFrames + ci->Frames;
 
 				//number of frames processed after we update progress
 				progressStep = ci->Frames / 100;
 				progressMark = progressStep;
 
-				//Netmon 2.x stores capture file info as a last frame; we do not want process it
-				if (ci->IsOldFormat)
-					frameCount--;
-
-				//allocate memory for frame table
-				UInt32 frameTableLength = ci->Frames*sizeof(DWORD);
-				frameTable = (LPDWORD) malloc(frameTableLength);
-				if (frameTable == nullptr)
-					throw gcnew OutOfMemoryException("AllocFrameTable");
-
-				//helper for ::ReadFile() API
-				DWORD dwBytesRead;
-
-				//open the capture file
-				pin_ptr<const wchar_t> inFile = PtrToStringChars(ci->Name);
-				inStream = ::CreateFile(inFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-				if (inStream == INVALID_HANDLE_VALUE)
-					throw gcnew System::ComponentModel::Win32Exception(::GetLastError(), "CreateFile");
-
-				//read frame table into memory
-				LPDWORD nextTableEntry = frameTable;
-				::SetFilePointer(inStream, ci->FrameTableOffset, NULL, FILE_BEGIN);
-				::ReadFile(inStream, frameTable, frameTableLength, &dwBytesRead, NULL);
-				if (dwBytesRead != frameTableLength)
-					throw gcnew Exception("Was not able to read complete frame table");
-
-				//pointer to buffer for frame metadata
-				LPFRAMEHEADER lpHdr = nullptr;
+				//open the capture file; we need frame data to get IP addresses
+				reader = FrameReader::Open(ci, true);
+
+				//buffer for frame metadata
+				FRAMEHEADER hdr;
+				LPFRAMEHEADER lpHdr = &hdr;
 				//pointer for raw frame data
-				//TODO: filtering based on IP address, port, protocol
 				LPBYTE rawFrameData = nullptr;
 
-				//eliminate netmon 3.x special frames - stored as first frames in file
-				bool isNetmonFrame = true;
-				ULONG numNetmonFrames = 0;
-				ULONG frameOffset = 0L;
-				do {
-					::SetFilePointer(inStream, *nextTableEntry, NULL, FILE_BEGIN);
-					lpHdr = (LPFRAMEHEADER) malloc(sizeof(FRAMEHEADER));
-					::ReadFile(inStream, lpHdr, sizeof(FRAMEHEADER), &dwBytesRead, NULL);
-					//skip frame data to get to MAC type
-					::SetFilePointer(inStream, lpHdr->BytesAvailable, NULL, FILE_CURRENT);
-					//get mac type
-					WORD frameMac;
-					::ReadFile(inStream, &frameMac, sizeof(WORD), &dwBytesRead, NULL);
-					if (frameMac<0xFFFB) {
-						//not a netmon special frame
-						isNetmonFrame = false;
-					}
-					else {
-						nextTableEntry++;
-						numNetmonFrames++;
+				//skip netmon 3.x special frames - stored as first frames in file
+				UInt32 firstFrame = ci->NetmonFrames;
+
+				//stats of this capture; checkpoint only holds them, not stats of other captures in pipeline
+				Dictionary<UInt32, Dictionary<UInt32, CaptureP2PStats^>^> ^captureData = gcnew Dictionary<UInt32, Dictionary<UInt32, CaptureP2PStats^>^>();
+
+				//continue with P2P table saved when previous run was interrupted
+				if (CheckpointPath != nullptr) {
+					checkpoint = gcnew CaptureCheckpoint(CheckpointPath, ci, "P2PStats", 0);
+					BinaryReader ^br = checkpoint->Load(firstFrame);
+					if (br != nullptr) {
+						try {
+							//table is only used when it was read completely
+							Dictionary<UInt32, Dictionary<UInt32, CaptureP2PStats^>^> ^saved = gcnew Dictionary<UInt32, Dictionary<UInt32, CaptureP2PStats^>^>();
+							UInt32 sources = br->ReadUInt32();
+							for (UInt32 s = 0; s < sources; s++) {
+								UInt32 source = br->ReadUInt32();
+								UInt32 destinations = br->ReadUInt32();
+								Dictionary<UInt32, CaptureP2PStats^> ^pom = gcnew Dictionary<UInt32, CaptureP2PStats^>();
+								for (UInt32 d = 0; d < destinations; d++) {
+									UInt32 dest = br->ReadUInt32();
+									CaptureP2PStats ^stats = gcnew CaptureP2PStats(source, dest);
+									stats->Frames = br->ReadUInt32();
+									stats->Bytes = br->ReadUInt32();
+									pom->Add(dest, stats);
+								}
+								saved->Add(source, pom);
+							}
+							captureData = saved;
+							if (progressStep > 0)
+								progressMark = (firstFrame / progressStep + 1) * progressStep;
+							WriteVerbose(String::Format(_template_CheckpointResumed, CaptureFile, firstFrame));
+						}
+						catch (IOException^) {
+							//damaged checkpoint - start from the beginning
+							firstFrame = ci->NetmonFrames;
+						}
+						catch (FormatException^) {
+							firstFrame = ci->NetmonFrames;
+						}
+						catch (UnauthorizedAccessException^) {
+							firstFrame = ci->NetmonFrames;
+						}
+						catch (ArgumentException^) {
+							//duplicate address in damaged checkpoint - start from the beginning
+							firstFrame = ci->NetmonFrames;
+						}
 					}
-					free(lpHdr);
-
-				} while (isNetmonFrame == true);
+				}
+				reader->Skip(firstFrame);
 
 				//process frames
-				for (UInt32 i = numNetmonFrames; i<frameCount; i++) {
+				for (UInt32 i = firstFrame; i<frameCount; i++) {
+					//state is saved before frame i is processed, so as resumed run starts with it
+					if (checkpoint != nullptr && checkpoint->IsDue()) {
+						BinaryWriter ^bw = checkpoint->Begin(i);
+						bw->Write((UInt32) captureData->Count);
+						for each (KeyValuePair<UInt32, Dictionary<UInt32, CaptureP2PStats^>^> source in captureData)
+						{
+							bw->Write(source.Key);
+							bw->Write((UInt32) source.Value->Count);
+							for each (KeyValuePair<UInt32, CaptureP2PStats^> kvp in source.Value)
+							{
+								bw->Write(kvp.Key);
+								bw->Write(kvp.Value->Frames);
+								bw->Write(kvp.Value->Bytes);
+							}
+						}
+						WarnCheckpointFailure(checkpoint->Save(bw));
+					}
 					if (ShowProgress && i > progressMark) {
 						ProgressRecord ^pr = gcnew ProgressRecord(
 							0,
@@ -387,35 +558,29 @@ namespace PSCap {
 						WriteProgress(pr);
 						progressMark += progressStep;
 					}
-					//get current frame in capture file
-					::SetFilePointer(inStream, *nextTableEntry, NULL, FILE_BEGIN);
-					nextTableEntry++;
-					//read frame metadata
-					lpHdr = (LPFRAMEHEADER) malloc(sizeof(FRAMEHEADER));
-					::ReadFile(inStream, lpHdr, sizeof(FRAMEHEADER), &dwBytesRead, NULL);
+					//read current frame in capture file
+					if (!reader->ReadFrame(lpHdr, &rawFrameData))
+						throw gcnew EndOfStreamException("Capture file ended before all frames were read");
 
 					//TODO: filtering based on IP address, port, protocol and detect ipv4/6 protocol data automatically
-					rawFrameData=(LPBYTE)malloc(lpHdr->BytesAvailable);
-					::ReadFile(inStream,rawFrameData,lpHdr->BytesAvailable,&dwBytesRead,NULL);
+					//frame data is not big enough to contain IPv4 addresses
+					if (lpHdr->BytesAvailable < 0x22)
+						continue;
 					UInt32 *pSource = (UINT32*)(rawFrameData + 0x1a);
 					UInt32 *pDest = (UINT32*) (rawFrameData + 0x1e);
 
-					if (!data->ContainsKey(*pSource)) {
-						data->Add(*pSource, gcnew Dictionary<UInt32, CaptureP2PStats^>());
-						data[*pSource]->Add(*pDest, gcnew CaptureP2PStats(*pSource, *pDest));
+					if (!captureData->ContainsKey(*pSource)) {
+						captureData->Add(*pSource, gcnew Dictionary<UInt32, CaptureP2PStats^>());
+						captureData[*pSource]->Add(*pDest, gcnew CaptureP2PStats(*pSource, *pDest));
 					}
 					else {
-						if (!data[*pSource]->ContainsKey(*pDest)) {
-							data[*pSource]->Add(*pDest, gcnew CaptureP2PStats(*pSource, *pDest));
+						if (!captureData[*pSource]->ContainsKey(*pDest)) {
+							captureData[*pSource]->Add(*pDest, gcnew CaptureP2PStats(*pSource, *pDest));
 						}
 					}
-					Dictionary<UInt32, CaptureP2PStats^> ^pom = data[*pSource];
+					Dictionary<UInt32, CaptureP2PStats^> ^pom = captureData[*pSource];
 					pom[*pDest]->Frames++;
 					pom[*pDest]->Bytes += lpHdr->FrameLength;
-
-					//prepare for the next frame
-					free(lpHdr);
-					free(rawFrameData);
 				}	//for
 				//write last status update
 				if (ShowProgress) {
@@ -434,6 +599,24 @@ namespace PSCap {
 					WriteProgress(pr);
 				}
 
+				//merge stats of this capture to stats of all captures processed in pipeline
+				for each (KeyValuePair<UInt32, Dictionary<UInt32, CaptureP2PStats^>^> source in captureData)
+				{
+					if (!data->ContainsKey(source.Key))
+						data->Add(source.Key, gcnew Dictionary<UInt32, CaptureP2PStats^>());
+					Dictionary<UInt32, CaptureP2PStats^> ^pom = data[source.Key];
+					for each (KeyValuePair<UInt32, CaptureP2PStats^> kvp in source.Value)
+					{
+						if (!pom->ContainsKey(kvp.Key)) {
+							pom->Add(kvp.Key, kvp.Value);
+						}
+						else {
+							pom[kvp.Key]->Frames += kvp.Value->Frames;
+							pom[kvp.Key]->Bytes += kvp.Value->Bytes;
+						}
+					}
+				}
+
 				//write data
 				for each (UInt32 source in data->Keys)
 				{
@@ -443,12 +626,26 @@ namespace PSCap {
 						WriteObject(kvp.Value);
 					}
 				}
+				if (checkpoint != nullptr)
+					WarnCheckpointFailure(checkpoint->Complete());
+			}
+			catch (Exception^) {
+				//analysis interrupted - resume relies on the last checkpoint, so tell when it was not written
+				if (checkpoint != nullptr) {
+					try {
+						WarnCheckpointFailure(checkpoint->Flush());
+					}
+					catch (PipelineStoppedException^) {
+						//warning cannot be written to stopped pipeline
+					}
+				}
+				throw;
 			}
 			finally {
-				if (inStream != INVALID_HANDLE_VALUE)
-					CloseHandle(inStream);
-				if (frameTable != nullptr)
-					free(frameTable);
+				if (reader != nullptr)
+					delete reader;
+				if (checkpoint != nullptr)
+					delete checkpoint;
 			}
 		}
 	};
@@ -23,34 +23,132 @@ namespace PSCap {
 			return DateTime::FromFileTimeUtc(pLI->QuadPart);
 		}
 
+		//reads block of data from given offset of the file; file handle does not keep position between calls
+		static void ReadAt(HANDLE hFile, UInt64 offset, LPVOID lpBuffer, DWORD length)
+		{
+			OVERLAPPED ov = { 0 };
+			DWORD dwBytesRead;
+
+			ov.Offset = (DWORD) offset;
+			ov.OffsetHigh = (DWORD) (offset >> 32);
+			if (!::ReadFile(hFile, lpBuffer, length, &dwBytesRead, &ov))
+				throw gcnew System::ComponentModel::Win32Exception(::GetLastError(), "ReadFile");
+			if (dwBytesRead != length)
+				throw gcnew EndOfStreamException("ReadAt");
+		}
+
+		//reads metadata of frame stored in given entry of frame table
+		static DWORD ReadFrameHeader(HANDLE hFile, CaptureFileInfo ^ci, UInt32 entry, LPFRAMEHEADER lpHdr)
+		{
+			DWORD frameOffset;
+
+			PSUtils::ReadAt(hFile, (UInt64) ci->FrameTableOffset + (UInt64) entry * sizeof(DWORD), &frameOffset, sizeof(DWORD));
+			PSUtils::ReadAt(hFile, frameOffset, lpHdr, sizeof(FRAMEHEADER));
+			return frameOffset;
+		}
+
+		//fills capture info from capture header; returns number of entries in frame table that are not 2.x trailer frame
+		static UInt32 ProcessFileHeader(CaptureFileInfo ^output, LPCAPFILEHEADER lpFileHeader)
+		{
+			output->Timestamp = PSUtils::GetStampAsDateTime(&(lpFileHeader->TimeStamp));
+			if (lpFileHeader->BCDVerMajor < 2 || (lpFileHeader->BCDVerMajor == 2 && lpFileHeader->BCDVerMinor == 0))
+				output->IsOldFormat = true;
+			output->FrameTableOffset = lpFileHeader->FrameTableOffset;
+			output->FrameTableEntries = lpFileHeader->FrameTableLength / sizeof(DWORD);
+
+			//Netmon 2.x stores capture file info as a last frame; it is not a real frame
+			UInt32 dataFrames = output->FrameTableEntries;
+			if (output->IsOldFormat && dataFrames > 0)
+				dataFrames--;
+			return dataFrames;
+		}
+
+		//frame timestamp is offset in microseconds from the capture timestamp
+		//netmon may write invalid timestamp for some frames; returns nullptr when it does not fit into DateTime
+		static DateTime^ GetFrameTimestamp(UInt64 captureTimestamp, UInt64 frameStamp)
+		{
+			UInt64 maxFileTime = (UInt64) DateTime::MaxValue.ToFileTimeUtc();
+			if (captureTimestamp > maxFileTime || frameStamp > (maxFileTime - captureTimestamp) / 10)
+				return nullptr;
+			return DateTime::FromFileTimeUtc(captureTimestamp + (frameStamp * 10));
+		}
+
+		//compressed capture file can only be read from the beginning, so last frame is not looked up
+		static CaptureFileInfo^ GetCompressedCaptureInfo(CaptureFileInfo ^output)
+		{
+			CAPFILEHEADER fileHeader;
+			FRAMEHEADER frameHeader;
+			CaptureStream ^cs = gcnew CaptureStream(output->Name, &fileHeader);
+			try {
+				output->IsCompressed = true;
+				UInt32 dataFrames = PSUtils::ProcessFileHeader(output, &fileHeader);
+
+				//netmon 3.x special frames - stored as first frames in file
+				while (output->NetmonFrames < dataFrames && cs->ReadFrameHeader(&frameHeader)) {
+					if (cs->ReadFrameData(&frameHeader, nullptr) < NETMON_SPECIAL_FRAME_MAC) {
+						output->FirstFrameTimestamp = PSUtils::GetFrameTimestamp(output->Timestamp->ToFileTimeUtc(), frameHeader.TimeStamp);
+						break;
+					}
+					output->NetmonFrames++;
+				}
+				output->Frames = dataFrames - output->NetmonFrames;
+			}
+			finally {
+				delete cs;
+			}
+			return output;
+		}
+
 		static CaptureFileInfo^ GetCaptureInfo(String^ fileName)
 		{
 			HANDLE inStream = INVALID_HANDLE_VALUE;
-			LPCAPFILEHEADER lpFileHeader = nullptr;
+			//all structures we need are fixed size, so no need for heap allocations
+			CAPFILEHEADER fileHeader;
+			FRAMEHEADER frameHeader;
+			DWORD frameOffset;
+			WORD frameMac;
 			pin_ptr<const wchar_t> inFile;
-			DWORD dwBytesRead;
 			CaptureFileInfo ^output = gcnew CaptureFileInfo(fileName);
 			try {
-				//capture file header handling
-				LPCAPFILEHEADER lpFileHeader = (LPCAPFILEHEADER) malloc(sizeof(CAPFILEHEADER));
-
+				//we only read few small blocks from the start and from the end of file
 				inFile = PtrToStringChars(fileName);
-				inStream = ::CreateFile(inFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+				inStream = ::CreateFile(inFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
 				if (inStream == INVALID_HANDLE_VALUE)
 					throw gcnew System::ComponentModel::Win32Exception(::GetLastError(), "CreateFile");
-				if (!::ReadFile(inStream, lpFileHeader, sizeof(CAPFILEHEADER), &dwBytesRead, NULL))
-					throw gcnew System::ComponentModel::Win32Exception(::GetLastError(), "ReadFile");
 
 				//capture header processing
-				output->Timestamp = PSUtils::GetStampAsDateTime(&(lpFileHeader->TimeStamp));
-				if (lpFileHeader->BCDVerMajor < 2 || (lpFileHeader->BCDVerMajor == 2 && lpFileHeader->BCDVerMinor == 0))
-					output->IsOldFormat = true;
-				output->Frames = lpFileHeader->FrameTableLength / sizeof(DWORD);
-				output->FrameTableOffset = lpFileHeader->FrameTableOffset;
+				PSUtils::ReadAt(inStream, 0, &fileHeader, sizeof(CAPFILEHEADER));
+				if ((fileHeader.Signature & 0xFFFF) == GZIP_SIGNATURE)
+					return PSUtils::GetCompressedCaptureInfo(output);
+				UInt32 dataFrames = PSUtils::ProcessFileHeader(output, &fileHeader);
+
+				//netmon 3.x special frames - stored as first frames in file; MAC type is stored with frames since 2.1 only
+				while (!output->IsOldFormat && output->NetmonFrames < dataFrames) {
+					frameOffset = PSUtils::ReadFrameHeader(inStream, output, output->NetmonFrames, &frameHeader);
+					//skip frame data to get to MAC type
+					PSUtils::ReadAt(inStream, (UInt64) frameOffset + sizeof(FRAMEHEADER) + frameHeader.BytesAvailable, &frameMac, sizeof(WORD));
+					if (frameMac < NETMON_SPECIAL_FRAME_MAC)
+						break;
+					output->NetmonFrames++;
+				}
+				output->Frames = dataFrames - output->NetmonFrames;
+				//1.x format uses different frame headers, so frame timestamps are not looked up
+				if (output->Frames == 0 || fileHeader.BCDVerMajor < 2)
+					return output;
+				if (output->IsOldFormat)
+					PSUtils::ReadFrameHeader(inStream, output, 0, &frameHeader);
+
+				UInt64 captureTimestamp = output->Timestamp->ToFileTimeUtc();
+				UInt64 firstFrameStamp = frameHeader.TimeStamp;
+				output->FirstFrameTimestamp = PSUtils::GetFrameTimestamp(captureTimestamp, firstFrameStamp);
+
+				PSUtils::ReadFrameHeader(inStream, output, dataFrames - 1, &frameHeader);
+				output->LastFrameTimestamp = PSUtils::GetFrameTimestamp(captureTimestamp, frameHeader.TimeStamp);
+				//do not report nonsense duration for invalid timestamps
+				if (output->FirstFrameTimestamp != nullptr && output->LastFrameTimestamp != nullptr && frameHeader.TimeStamp >= firstFrameStamp)
+					output->Duration = TimeSpan::FromTicks((Int64) (frameHeader.TimeStamp - firstFrameStamp) * 10);
 			}
 			finally {
-				if (lpFileHeader != nullptr)
-					free(lpFileHeader);
 				if (inStream != INVALID_HANDLE_VALUE)
 					CloseHandle(inStream);
 			}